@@ -104,6 +104,31 @@ namespace neuralnetworks {
          */
         void weightsUpdate(const std::vector<unsigned int> &BMU, unsigned int currentIteration, const boost::numeric::ublas::vector<double>& inputDataAttributes);
 
+        /**
+         * Check batch training parameters and initialize the epochs and time constant
+         * @param epochs Number of batch training epochs (full passes over the training data)
+         */
+        void batchTrainingInitialization(unsigned int epochs);
+
+        /**
+         * Add the contribution of a single data sample to the batch SOM accumulators for the current weights lattice
+         * @param inputDataAttributes vector of input data sample attributes
+         * @param radius Neighborhood radius based on the current epoch
+         * @param numerator flat array (height x width x dimension) of the neighborhood-weighted sums of data samples
+         * @param denominator flat array (height x width) of the neighborhood weights sums
+         */
+        void batchAccumulate(const boost::numeric::ublas::vector<double>& inputDataAttributes, double radius, double *numerator, double *denominator);
+
+        /**
+         * Replace the weights of the nodes in range [firstNode, lastNode) by the ratio of the batch SOM accumulators. \n
+         * Nodes are indexed as i * width + j. Nodes without any contribution keep their weights
+         * @param numerator flat array (height x width x dimension) of the neighborhood-weighted sums of data samples
+         * @param denominator flat array (height x width) of the neighborhood weights sums
+         * @param firstNode first node to update
+         * @param lastNode node after the last one to update
+         */
+        void batchUpdate(const double *numerator, const double *denominator, unsigned int firstNode, unsigned int lastNode);
+
 
     public:
 
@@ -171,6 +196,28 @@ namespace neuralnetworks {
          */
         void somTraining(unsigned int epochs, double learningStep);
 
+        /**
+         * Batch training procedure of SOM. Each epoch finds BMU of all training data samples for the current weights \n
+         * and replaces the weights by the neighborhood-weighted mean of the data. Samples are processed in parallel with OpenMP. \n
+         * assignedNode is rebuilt from the final weights lattice
+         * @param epochs Number of batch training epochs (full passes over the training data)
+         */
+        void somBatchTraining(unsigned int epochs);
+
+        /**
+         * Multi-process sharded batch training of SOM (Linux only, no network involved). \n
+         * Training data are split into equal shards between forked worker processes. On each epoch every worker accumulates \n
+         * the batch SOM numerator and denominator of its shard into own slot of a shared memory segment, then each worker \n
+         * reduces a range of nodes over all slots and writes the new weights into the shared weights lattice read by all workers on the next epoch. \n
+         * The calling process acts as coordinator: it waits for the workers and copies the final weights lattice and assignedNode back. \n
+         * SIGCHLD disposition is set to default during the call, workers reaped by the calling program are checked through the shared memory
+         * @param epochs Number of batch training epochs (full passes over the training data)
+         * @param workers Number of worker processes (limited by the number of training data samples)
+         * @param numaPlacement Pin the workers round-robin to the CPUs of the NUMA nodes, so the slots and the worker's copy of its shard are allocated on the local node at first touch. \n
+         * Throws if NUMA information is not available in sysfs or a worker can not be pinned
+         */
+        void somShardedBatchTraining(unsigned int epochs, unsigned int workers, bool numaPlacement = false);
+
         /**
          * Safe return of the weights lattice
          * @return boost::numeric::ublas::matrix<boost::numeric::ublas::vector<double> > 3d array
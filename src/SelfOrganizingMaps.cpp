@@ -12,8 +12,77 @@
  */
 #include<SelfOrganizingMaps.h>
 
+/**
+ * Include POSIX / Linux API for the sharded training (processes, shared memory, CPU affinity)
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace neuralnetworks;
 
+namespace {
+
+    /**
+     * Parse the sysfs list of ids (format "0-3,8-11")
+     * @param path path to the sysfs file
+     * @return ids from the list, empty if the file is not available
+     */
+    std::vector<int> sysfsList(const std::string &path) {
+        std::vector<int> ids;
+        std::ifstream file(path.c_str());
+        std::string range;
+        while (std::getline(file, range, ',')) {
+            int first = 0, last = 0;
+            int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (n < 1)
+                continue;
+            if (n == 1)
+                last = first;
+            for (int id = first; id <= last; id++)
+                ids.push_back(id);
+        }
+        return ids;
+    }
+
+    /**
+     * Read CPU lists of all online NUMA nodes from sysfs. Node ids can be sparse (e.g. "0,2")
+     * @return CPU ids per NUMA node, empty if NUMA information is not available
+     */
+    std::vector<std::vector<int> > numaNodesCpus() {
+        std::vector<std::vector<int> > nodes;
+        std::vector<int> online = sysfsList("/sys/devices/system/node/online");
+        for (unsigned int n = 0; n < online.size(); n++) {
+            std::ostringstream path;
+            path << "/sys/devices/system/node/node" << online[n] << "/cpulist";
+            std::vector<int> cpus = sysfsList(path.str());
+            //Memory-only nodes have no CPUs
+            if (!cpus.empty())
+                nodes.push_back(cpus);
+        }
+        return nodes;
+    }
+
+    /**
+     * Round up the size in bytes to the whole number of memory pages
+     */
+    size_t pageAligned(size_t bytes) {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        return (bytes + page - 1) / page * page;
+    }
+}
+
 SelfOrganizingMaps::SelfOrganizingMaps(unsigned int inputDimension, unsigned int somHeight, unsigned int somWidth) : weightsLattice(somHeight, somWidth), assignedNode(somHeight, somWidth) {
     if (inputDimension == 0) {
         std::string str("Error! The dimension is 0!");
@@ -175,6 +244,344 @@ void SelfOrganizingMaps::somTraining(unsigned int epochs, double learningStep) {
     std::vector<unsigned int> ().swap(BMUcoordinates);
 }
 
+void SelfOrganizingMaps::batchTrainingInitialization(unsigned int epochs) {
+    if (epochs == 0) {
+        std::string str("Error! The amount of epochs should not be 0!");
+        throw std::runtime_error(str.c_str());
+    }
+    if (trainingData.size() == 0) {
+        std::string str("Error! There is no training data!");
+        throw std::runtime_error(str.c_str());
+    }
+
+    //Initialize private variables
+    Epochs = epochs;
+
+    //Time constant, the radius decreases from sigma0 to 1 during the training
+    lambda = (double) Epochs / log(sigma0);
+}
+
+void SelfOrganizingMaps::batchAccumulate(const boost::numeric::ublas::vector<double>& inputDataAttributes, double radius, double *numerator, double *denominator) {
+    std::vector<unsigned int> BMU = bestMatchingUnit(inputDataAttributes);
+    double tmpDist, theta;
+
+    for (unsigned int i = 0; i < height; i++)
+        for (unsigned int j = 0; j < width; j++) {
+            //Squared Euclidean Distance from BMU to current node
+            tmpDist = pow((double) BMU[0] - (double) i, 2) + pow((double) BMU[1] - (double) j, 2);
+            //Effect of the data sample on the node based on the distance from BMU (theta(t))
+            theta = exp(-tmpDist / (2 * pow(radius, 2)));
+            //Accumulate
+            unsigned int node = i * width + j;
+            denominator[node] += theta;
+            for (unsigned int k = 0; k < dimension; k++)
+                numerator[node * dimension + k] += theta * inputDataAttributes(k);
+        }
+}
+
+void SelfOrganizingMaps::batchUpdate(const double *numerator, const double *denominator, unsigned int firstNode, unsigned int lastNode) {
+    for (unsigned int node = firstNode; node < lastNode; node++) {
+        //Node far away from all data samples, keep the weights
+        if (denominator[node] <= 0)
+            continue;
+        for (unsigned int k = 0; k < dimension; k++)
+            weightsLattice(node / width, node % width)(k) = numerator[node * dimension + k] / denominator[node];
+    }
+}
+
+void SelfOrganizingMaps::somBatchTraining(unsigned int epochs) {
+    batchTrainingInitialization(epochs);
+
+    const unsigned int nodes = height * width;
+    const unsigned int numeratorSize = nodes * dimension;
+    const long samples = (long) trainingData.size();
+    std::vector<double> numerator(numeratorSize), denominator(nodes);
+
+    //Accumulators of every thread are kept on the heap, the lattice can be larger than the thread stack
+    unsigned int maxThreadsNumber = 1;
+#ifdef _OPENMP
+    maxThreadsNumber = omp_get_max_threads();
+#endif
+    std::vector<std::vector<double> > threadNumerator(maxThreadsNumber), threadDenominator(maxThreadsNumber);
+
+    //The training process
+    for (unsigned int i = 0; i < Epochs; i++) {
+        double radius = currentNeighbourhoodRadius(i);
+
+#pragma omp parallel
+        {
+            unsigned int thread = 0, threads = 1;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+            threads = omp_get_num_threads();
+#endif
+            //Every thread accumulates into its own arrays
+            threadNumerator[thread].assign(numeratorSize, 0.0);
+            threadDenominator[thread].assign(nodes, 0.0);
+            double *num = &threadNumerator[thread][0], *den = &threadDenominator[thread][0];
+#pragma omp for
+            for (long j = 0; j < samples; j++)
+                batchAccumulate(trainingData[j], radius, num, den);
+
+            //Sum up the arrays of all threads per node
+#pragma omp for
+            for (long node = 0; node < (long) nodes; node++) {
+                denominator[node] = 0;
+                for (unsigned int t = 0; t < threads; t++)
+                    denominator[node] += threadDenominator[t][node];
+                for (unsigned int k = 0; k < dimension; k++) {
+                    numerator[node * dimension + k] = 0;
+                    for (unsigned int t = 0; t < threads; t++)
+                        numerator[node * dimension + k] += threadNumerator[t][node * dimension + k];
+                }
+            }
+        }
+
+        batchUpdate(&numerator[0], &denominator[0], 0, nodes);
+    }
+
+    //Assign training data to the nodes of the trained SOM, BMU are found in parallel
+    std::vector<unsigned int> BMUid(samples);
+#pragma omp parallel for
+    for (long j = 0; j < samples; j++) {
+        std::vector<unsigned int> BMU = bestMatchingUnit(trainingData[j]);
+        BMUid[j] = BMU[0] * width + BMU[1];
+    }
+    for (unsigned int j = 0; j < height; j++)
+        for (unsigned int k = 0; k < width; k++)
+            assignedNode(j, k).clear();
+    for (unsigned int j = 0; j < samples; j++)
+        assignedNode(BMUid[j] / width, BMUid[j] % width).insert(std::pair<unsigned int, unsigned int >(j, j));
+}
+
+void SelfOrganizingMaps::somShardedBatchTraining(unsigned int epochs, unsigned int workers, bool numaPlacement) {
+    batchTrainingInitialization(epochs);
+    if (workers == 0) {
+        std::string str("Error! The amount of workers should not be 0!");
+        throw std::runtime_error(str.c_str());
+    }
+    const unsigned int samples = trainingData.size();
+    if (workers > samples)
+        workers = samples;
+
+    std::vector<std::vector<int> > numaNodes;
+    if (numaPlacement) {
+        numaNodes = numaNodesCpus();
+        if (numaNodes.empty()) {
+            std::string str("Error! NUMA information is not available for the workers placement!");
+            throw std::runtime_error(str.c_str());
+        }
+    }
+
+    const unsigned int nodes = height * width;
+    const unsigned int numeratorSize = nodes * dimension;
+
+    //Layout of the shared memory segment, every part starts on a new page:
+    //barrier | finished flag per worker | weights lattice | BMU id per data sample | slot per worker (accumulation and reduction areas of numerator, denominator)
+    const size_t barrierBytes = pageAligned(sizeof (pthread_barrier_t));
+    const size_t finishedBytes = pageAligned(workers * sizeof (int));
+    const size_t latticeBytes = pageAligned(numeratorSize * sizeof (double));
+    const size_t bmuBytes = pageAligned(samples * sizeof (unsigned int));
+    const size_t areaBytes = pageAligned((numeratorSize + nodes) * sizeof (double));
+    const size_t slotBytes = 2 * areaBytes;
+    const size_t segmentBytes = barrierBytes + finishedBytes + latticeBytes + bmuBytes + workers * slotBytes;
+
+    //Anonymous shared mapping is inherited by the forked workers. Pages are zero-filled and allocated at first touch
+    char *segment = (char *) mmap(NULL, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (segment == MAP_FAILED) {
+        std::string str("Error! Can not allocate the shared memory segment!");
+        throw std::runtime_error(str.c_str());
+    }
+    pthread_barrier_t *barrier = (pthread_barrier_t *) segment;
+    volatile int *sharedFinished = (volatile int *) (segment + barrierBytes);
+    double *sharedLattice = (double *) (segment + barrierBytes + finishedBytes);
+    unsigned int *sharedBMU = (unsigned int *) (segment + barrierBytes + finishedBytes + latticeBytes);
+    char *slots = segment + barrierBytes + finishedBytes + latticeBytes + bmuBytes;
+
+    pthread_barrierattr_t barrierAttr;
+    pthread_barrierattr_init(&barrierAttr);
+    pthread_barrierattr_setpshared(&barrierAttr, PTHREAD_PROCESS_SHARED);
+    int barrierStatus = pthread_barrier_init(barrier, &barrierAttr, workers);
+    pthread_barrierattr_destroy(&barrierAttr);
+    if (barrierStatus != 0) {
+        munmap(segment, segmentBytes);
+        std::string str("Error! Can not initialize the shared barrier!");
+        throw std::runtime_error(str.c_str());
+    }
+
+    //Broadcast the initial weights lattice
+    for (unsigned int node = 0; node < nodes; node++)
+        for (unsigned int k = 0; k < dimension; k++)
+            sharedLattice[node * dimension + k] = weightsLattice(node / width, node % width)(k);
+
+    //Avoid duplication of the buffered output in the workers
+    fflush(NULL);
+
+    //With SIGCHLD ignored by the calling program the workers would be reaped automatically, restored at the end
+    struct sigaction childAction, previousChildAction;
+    memset(&childAction, 0, sizeof (childAction));
+    childAction.sa_handler = SIG_DFL;
+    sigemptyset(&childAction.sa_mask);
+    sigaction(SIGCHLD, &childAction, &previousChildAction);
+
+    std::vector<pid_t> pids;
+    for (unsigned int w = 0; w < workers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            //Started workers would wait on the barrier forever
+            for (unsigned int p = 0; p < pids.size(); p++) {
+                kill(pids[p], SIGKILL);
+                waitpid(pids[p], NULL, 0);
+            }
+            //The barrier is not destroyed, killed workers never leave it
+            munmap(segment, segmentBytes);
+            sigaction(SIGCHLD, &previousChildAction, NULL);
+            std::string str("Error! Can not start the worker process!");
+            throw std::runtime_error(str.c_str());
+        }
+        if (pid > 0) {
+            pids.push_back(pid);
+            continue;
+        }
+
+        //----------------WORKER PROCESS------------------------------
+        try {
+            if (!numaNodes.empty()) {
+                const std::vector<int> &cpus = numaNodes[w % numaNodes.size()];
+                cpu_set_t cpuSet;
+                CPU_ZERO(&cpuSet);
+                for (unsigned int c = 0; c < cpus.size(); c++)
+                    if (cpus[c] < CPU_SETSIZE)
+                        CPU_SET(cpus[c], &cpuSet);
+                //Placement is not possible (e.g. CPUs forbidden by cpuset), the coordinator reports the failed worker
+                if (CPU_COUNT(&cpuSet) == 0 || sched_setaffinity(0, sizeof (cpuSet), &cpuSet) != 0)
+                    _exit(EXIT_FAILURE);
+            }
+
+            //Own shard of the training data and own range of the nodes for the reduction
+            const unsigned int firstSample = (unsigned long) samples * w / workers;
+            const unsigned int lastSample = (unsigned long) samples * (w + 1) / workers;
+            const unsigned int firstNode = (unsigned long) nodes * w / workers;
+            const unsigned int lastNode = (unsigned long) nodes * (w + 1) / workers;
+            double *numerator = (double *) (slots + w * slotBytes);
+            double *denominator = numerator + numeratorSize;
+            double *totalNumerator = (double *) (slots + w * slotBytes + areaBytes);
+            double *totalDenominator = totalNumerator + numeratorSize;
+
+            //Own copy of the shard, allocated after the placement, instead of the coordinator's copy-on-write pages
+            std::vector<boost::numeric::ublas::vector<double> > shard(trainingData.begin() + firstSample, trainingData.begin() + lastSample);
+
+            for (unsigned int i = 0; i <= Epochs; i++) {
+                //Read the weights lattice broadcasted on the previous epoch
+                for (unsigned int node = 0; node < nodes; node++)
+                    for (unsigned int k = 0; k < dimension; k++)
+                        weightsLattice(node / width, node % width)(k) = sharedLattice[node * dimension + k];
+
+                //Final assignment of the shard to the nodes of the trained SOM
+                if (i == Epochs) {
+                    for (unsigned int j = firstSample; j < lastSample; j++) {
+                        std::vector<unsigned int> BMU = bestMatchingUnit(shard[j - firstSample]);
+                        sharedBMU[j] = BMU[0] * width + BMU[1];
+                    }
+                    __sync_synchronize();
+                    sharedFinished[w] = 1;
+                    break;
+                }
+
+                //Local accumulation. The slot is first touched by its worker, so it resides on the worker's NUMA node
+                double radius = currentNeighbourhoodRadius(i);
+                std::fill(numerator, numerator + numeratorSize + nodes, 0.0);
+                for (unsigned int j = 0; j < shard.size(); j++)
+                    batchAccumulate(shard[j], radius, numerator, denominator);
+                pthread_barrier_wait(barrier);
+
+                //Reduction of the own nodes range over all slots into the own reduction area and broadcast of the new weights.
+                //Only the own range of the reduction area is touched, so it also resides on the worker's NUMA node
+                for (unsigned int node = firstNode; node < lastNode; node++) {
+                    totalDenominator[node] = 0;
+                    for (unsigned int k = 0; k < dimension; k++)
+                        totalNumerator[node * dimension + k] = 0;
+                }
+                for (unsigned int s = 0; s < workers; s++) {
+                    const double *slotNumerator = (const double *) (slots + s * slotBytes);
+                    const double *slotDenominator = slotNumerator + numeratorSize;
+                    for (unsigned int node = firstNode; node < lastNode; node++) {
+                        totalDenominator[node] += slotDenominator[node];
+                        for (unsigned int k = 0; k < dimension; k++)
+                            totalNumerator[node * dimension + k] += slotNumerator[node * dimension + k];
+                    }
+                }
+                batchUpdate(totalNumerator, totalDenominator, firstNode, lastNode);
+                for (unsigned int node = firstNode; node < lastNode; node++)
+                    for (unsigned int k = 0; k < dimension; k++)
+                        sharedLattice[node * dimension + k] = weightsLattice(node / width, node % width)(k);
+                pthread_barrier_wait(barrier);
+            }
+        } catch (...) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+        //----------------END OF WORKER PROCESS------------------------------
+    }
+
+    //----------------COORDINATOR------------------------------
+    //Poll the workers, since a failed worker leaves the rest waiting on the barrier
+    bool failed = false;
+    std::vector<unsigned int> running; //ids of the running workers
+    for (unsigned int w = 0; w < workers; w++)
+        running.push_back(w);
+    struct timespec pollInterval = {0, 1000000};
+    while (!running.empty()) {
+        for (unsigned int p = 0; p < running.size();) {
+            int status = 0;
+            pid_t pid = waitpid(pids[running[p]], &status, WNOHANG);
+            if (pid == 0 || (pid < 0 && errno == EINTR)) {
+                p++;
+                continue;
+            }
+            if (pid < 0) {
+                //Already reaped by the calling program (ECHILD), succeeded only if the worker has finished its work
+                if (!sharedFinished[running[p]])
+                    failed = true;
+            } else if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+                failed = true;
+            running.erase(running.begin() + p);
+        }
+        if (failed) {
+            for (unsigned int p = 0; p < running.size(); p++) {
+                kill(pids[running[p]], SIGKILL);
+                waitpid(pids[running[p]], NULL, 0);
+            }
+            break;
+        }
+        if (!running.empty())
+            nanosleep(&pollInterval, NULL);
+    }
+
+    if (!failed) {
+        //Copy back the trained weights lattice and the assignment of the training data
+        for (unsigned int node = 0; node < nodes; node++)
+            for (unsigned int k = 0; k < dimension; k++)
+                weightsLattice(node / width, node % width)(k) = sharedLattice[node * dimension + k];
+        for (unsigned int i = 0; i < height; i++)
+            for (unsigned int j = 0; j < width; j++)
+                assignedNode(i, j).clear();
+        for (unsigned int j = 0; j < samples; j++)
+            assignedNode(sharedBMU[j] / width, sharedBMU[j] % width).insert(std::pair<unsigned int, unsigned int >(j, j));
+    }
+
+    sigaction(SIGCHLD, &previousChildAction, NULL);
+
+    //The barrier is destroyed only if no worker was killed while waiting on it
+    if (!failed)
+        pthread_barrier_destroy(barrier);
+    munmap(segment, segmentBytes);
+    if (failed) {
+        std::string str("Error! The worker process of the sharded training has failed!");
+        throw std::runtime_error(str.c_str());
+    }
+}
+
 void SelfOrganizingMaps::pushData(const boost::numeric::ublas::vector<double>& inputDataAttributes) {
     if (inputDataAttributes.size() == 0 || inputDataAttributes.size() != dimension) {
         std::string str("Error! The fed vector of attributes has a wrong dimensionality!!");
@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <ctime> //performace measurements
 #include <cstdlib>
+#include <csignal> //SIGCHLD disposition
 
 
 /**
@@ -260,21 +261,219 @@ void test1() {
     }
 }
 
+/*
+ * Check that every training data sample of the sharded SOM is assigned to a BMU of the reference SOM. \n
+ * Nodes at equal distance (up to the summation order of the weights) are accepted as the same BMU
+ */
+bool sameAssignment(neuralnetworks::SelfOrganizingMaps &sharded, neuralnetworks::SelfOrganizingMaps &reference) {
+    const boost::numeric::ublas::matrix<boost::numeric::ublas::vector<double> > &weights = reference.returnWeightsLattice();
+    std::map<unsigned int, unsigned int >::iterator it;
+    unsigned int assigned = 0;
+    for (unsigned int i = 0; i < sharded.height; i++)
+        for (unsigned int j = 0; j < sharded.width; j++)
+            for (it = sharded.assignedNode(i, j).begin(); it != sharded.assignedNode(i, j).end(); it++) {
+                double minDistance = DBL_MAX;
+                for (unsigned int m = 0; m < reference.height; m++)
+                    for (unsigned int n = 0; n < reference.width; n++)
+                        minDistance = std::min(minDistance, norm_2(reference.trainingData[it->first] - weights(m, n)));
+                if (norm_2(reference.trainingData[it->first] - weights(i, j)) - minDistance > errorThreshold)
+                    return false;
+                assigned++;
+            }
+    return assigned == reference.trainingData.size();
+}
+
+/*
+ * Scaling benchmark of the batch SOM training: single-process OpenMP path vs multi-process sharded path
+ */
+void test2() {
+    std::cout << "test_SelfOrganizingMaps test 2" << std::endl;
+
+    try {
+        unsigned int height = 10, width = 10, epochs = 10, replicas = 200; //benchmark parameters
+        boost::numeric::ublas::vector<double> inputDataAttributes(numFeatures);
+        std::vector<boost::numeric::ublas::vector<double> > irisData;
+        double tmp1, cl;
+
+        //---------------- READING TRAIN DATA------------------------------
+        FILE *pFileTrain;
+        if ((pFileTrain = fopen("iris.txt", "rt")) == NULL) {
+            puts("Error while opening input train file!");
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=no iris.txt" << std::endl;
+            return;
+        }
+        while (!feof(pFileTrain)) {
+            for (int i = 0; i < numFeatures; i++) {
+                if (fscanf(pFileTrain, "%lf ", &tmp1) != 1)
+                    break;
+                inputDataAttributes(i) = tmp1;
+            }
+            if (fscanf(pFileTrain, "%lf ", &cl) != 1)
+                break;
+            irisData.push_back(inputDataAttributes);
+        }
+        fclose(pFileTrain);
+        //---------------- END OF READING TRAIN DATA------------------------------
+
+        //Replicate the data set to get a measurable amount of work
+        neuralnetworks::SelfOrganizingMaps obj(numFeatures, height, width);
+        for (unsigned int r = 0; r < replicas; r++)
+            for (unsigned int i = 0; i < irisData.size(); i++)
+                obj.pushData(irisData[i]);
+        obj.weightsInitialization(0.1, 0.5);
+        printf("Samples %lu, SOM %dx%d, epochs %d\n", obj.trainingData.size(), height, width, epochs);
+
+        //Sharded training has to reproduce the weights of the single-process path up to the summation order.
+        //Checked after one epoch only: later epochs may resolve BMU ties (duplicated samples) differently
+        neuralnetworks::SelfOrganizingMaps reference(obj), sharded(obj);
+        reference.somBatchTraining(1);
+        sharded.somShardedBatchTraining(1, maxThreads);
+        double maxDifference = 0;
+        for (unsigned int i = 0; i < height; i++)
+            for (unsigned int j = 0; j < width; j++)
+                for (unsigned int k = 0; k < numFeatures; k++)
+                    maxDifference = std::max(maxDifference, fabs(sharded.returnWeightsLattice()(i, j)(k) - reference.returnWeightsLattice()(i, j)(k)));
+        printf("Max weights difference after one epoch: %g\n", maxDifference);
+        if (maxDifference > errorThreshold)
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=sharded weights differ" << std::endl;
+
+        //Assignment of the training data rebuilt from the workers' BMU ids
+        if (!sameAssignment(sharded, reference))
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=sharded assignedNode differs" << std::endl;
+
+        //No workers
+        bool thrown = false;
+        try {
+            neuralnetworks::SelfOrganizingMaps noWorkers(obj);
+            noWorkers.somShardedBatchTraining(1, 0);
+        } catch (std::runtime_error e) {
+            thrown = true;
+        }
+        if (!thrown)
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=0 workers accepted" << std::endl;
+
+        //Failed worker (empty data sample at the end of the last shard, the rest wait on the barrier) is reported by the exception
+        thrown = false;
+        try {
+            neuralnetworks::SelfOrganizingMaps failing(obj);
+            failing.trainingData.back().resize(0);
+            failing.somShardedBatchTraining(1, maxThreads);
+        } catch (std::runtime_error e) {
+            thrown = true;
+        }
+        if (!thrown)
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=failed worker not reported" << std::endl;
+
+        //Calling program ignoring SIGCHLD (workers would be reaped automatically)
+        thrown = false;
+        try {
+            neuralnetworks::SelfOrganizingMaps ignoring(obj);
+            signal(SIGCHLD, SIG_IGN);
+            ignoring.somShardedBatchTraining(1, maxThreads);
+        } catch (std::runtime_error e) {
+            thrown = true;
+        }
+        signal(SIGCHLD, SIG_DFL);
+        if (thrown)
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=sharded training failed with SIGCHLD ignored" << std::endl;
+
+        //More workers than training data samples are limited to the number of samples
+        neuralnetworks::SelfOrganizingMaps fewReference(numFeatures, height, width);
+        for (unsigned int i = 0; i < 3; i++)
+            fewReference.pushData(irisData[i * 50]);
+        fewReference.weightsInitialization(0.1, 0.5);
+        neuralnetworks::SelfOrganizingMaps fewSharded(fewReference);
+        fewReference.somBatchTraining(1);
+        fewSharded.somShardedBatchTraining(1, maxThreads);
+        maxDifference = 0;
+        for (unsigned int i = 0; i < height; i++)
+            for (unsigned int j = 0; j < width; j++)
+                for (unsigned int k = 0; k < numFeatures; k++)
+                    maxDifference = std::max(maxDifference, fabs(fewSharded.returnWeightsLattice()(i, j)(k) - fewReference.returnWeightsLattice()(i, j)(k)));
+        if (maxDifference > errorThreshold || !sameAssignment(fewSharded, fewReference))
+            std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=sharded training with more workers than samples differs" << std::endl;
+
+        //Single-process parallel path as the baseline
+        neuralnetworks::SelfOrganizingMaps single(obj);
+        double start = omp_get_wtime();
+        single.somBatchTraining(epochs);
+        double singleTime = omp_get_wtime() - start;
+        printf("Single-process batch (%d OMP threads): %f s\n", omp_get_max_threads(), singleTime);
+
+        //Sharded path with growing number of workers up to the number of OMP threads, with and without NUMA placement
+        unsigned int workersNumber[] = {1, 2, 4, maxThreads};
+        FILE *pNumaOnline = fopen("/sys/devices/system/node/online", "rt"); //NUMA placement throws without NUMA information
+        unsigned int numaModes = pNumaOnline != NULL ? 2 : 1;
+        if (pNumaOnline != NULL)
+            fclose(pNumaOnline);
+        else
+            puts("No NUMA information, sharded batch with NUMA placement skipped");
+        for (unsigned int numa = 0; numa < numaModes; numa++)
+            for (unsigned int w = 0; w < sizeof (workersNumber) / sizeof (workersNumber[0]); w++) {
+                unsigned int workers = workersNumber[w];
+                neuralnetworks::SelfOrganizingMaps scaled(obj);
+                start = omp_get_wtime();
+                scaled.somShardedBatchTraining(epochs, workers, numa == 1);
+                double shardedTime = omp_get_wtime() - start;
+                printf("Sharded batch (%d workers, NUMA %s): %f s, speedup %.2f\n",
+                        workers, numa ? "on" : "off", shardedTime, singleTime / shardedTime);
+            }
+    } catch (std::runtime_error e) {
+
+        std::cout << e.what();
+        std::cout << "%TEST_FAILED% time=0 testname=test2 (test_SelfOrganizingMaps) message=exception" << std::endl;
+    }
+}
+
+/*
+ * Batch training of the SOM lattice with accumulators larger than the default 8 MB thread stack
+ */
+void test3() {
+    std::cout << "test_SelfOrganizingMaps test 3" << std::endl;
+
+    try {
+        unsigned int height = 120, width = 120, dimension = 100, samples = 20; //numerator of 11.5 MB
+        neuralnetworks::SelfOrganizingMaps obj(dimension, height, width);
+        boost::numeric::ublas::vector<double> inputDataAttributes(dimension);
+        for (unsigned int j = 0; j < samples; j++) {
+            for (unsigned int k = 0; k < dimension; k++)
+                inputDataAttributes(k) = rand() / (double) RAND_MAX;
+            obj.pushData(inputDataAttributes);
+        }
+        obj.weightsInitialization(0.1, 0.5);
+        obj.somBatchTraining(1);
+
+        unsigned int assigned = 0;
+        for (unsigned int i = 0; i < height; i++)
+            for (unsigned int j = 0; j < width; j++)
+                assigned += obj.assignedNode(i, j).size();
+        printf("Samples assigned to the %dx%d SOM: %d\n", height, width, assigned);
+        if (assigned != samples)
+            std::cout << "%TEST_FAILED% time=0 testname=test3 (test_SelfOrganizingMaps) message=not all samples assigned" << std::endl;
+    } catch (std::runtime_error e) {
+
+        std::cout << e.what();
+        std::cout << "%TEST_FAILED% time=0 testname=test3 (test_SelfOrganizingMaps) message=exception" << std::endl;
+    }
+}
+
 int main(int argc, char** argv) {
     std::cout << "\n%SUITE_STARTING% test_SelfOrganizingMaps\n" << std::endl;
     std::cout << "\n%SUITE_STARTED%\n" << std::endl;
 
     std::cout << "\n%TEST_STARTED% test1 (test_SelfOrganizingMaps)\n" << std::endl;
     test1();
-    /*
     std::cout << "%TEST_FINISHED% time=0 test1 (test_SelfOrganizingMaps)" << std::endl;
 
     std::cout << "%TEST_STARTED% test2 (test_SelfOrganizingMaps)\n" << std::endl;
     test2();
     std::cout << "%TEST_FINISHED% time=0 test2 (test_SelfOrganizingMaps)" << std::endl;
 
+    std::cout << "%TEST_STARTED% test3 (test_SelfOrganizingMaps)\n" << std::endl;
+    test3();
+    std::cout << "%TEST_FINISHED% time=0 test3 (test_SelfOrganizingMaps)" << std::endl;
+
     std::cout << "%SUITE_FINISHED% time=0" << std::endl;
-     */
     //getchar();
     return (EXIT_SUCCESS);
 }